@@ -0,0 +1,402 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <numbers>
+#include <random>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <thread>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "phong.h"
+
+#ifndef BENCH_OBJ_DIR
+#define BENCH_OBJ_DIR "obj"
+#endif
+
+// The benchmarks are self-timed: each one is a callable doing a single "operation",
+// the harness calibrates the number of iterations to fill min_time seconds,
+// repeats the measurement and keeps the median time per operation.
+
+struct Result {
+    std::string name;
+    long long iterations;
+    double ns_per_op;
+};
+
+struct Options {
+    std::string filter   = "";            // run only the benchmarks whose name contains this substring
+    std::string obj_dir  = BENCH_OBJ_DIR; // where to find the bundled models
+    std::string json     = "";            // dump the results to this file
+    std::string baseline = "";            // compare the results against this file
+    double min_time  = .2;                // seconds per measurement
+    double threshold = .1;                // relative slowdown flagged as a regression
+    int repeats = 3;
+};
+
+static volatile double sink = 0; // keeps the compiler from optimizing the benchmarked code away
+
+// Makes the compiler assume that value is read and modified behind its back: the computation of a result
+// passed to escape() can not be dropped, and a computation depending on an escaped input can not be hoisted.
+template<typename T> static void escape(T &value) {
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : "+m"(value) : : "memory");
+#else
+    static void * volatile escaped = nullptr;
+    escaped = &value;
+#endif
+}
+
+struct Bench {
+    const Options &opt;
+    std::vector<Result> results = {};
+
+    bool selected(const std::string &name) const {
+        return name.find(opt.filter)!=std::string::npos;
+    }
+
+    void run(const std::string &name, const std::function<void()> &op) {
+        if (!selected(name)) return;
+        using clock = std::chrono::steady_clock;
+        auto measure = [&op](long long n) {
+            auto start = clock::now();
+            for (long long i=0; i<n; i++) op();
+            return std::chrono::duration<double>(clock::now() - start).count();
+        };
+        long long n = 1; // calibrate the number of iterations, grow it until the batch lasts long enough
+        for (double t = measure(n); t<opt.min_time && n<(1ll<<40); t = measure(n))
+            n = std::max(n*2, static_cast<long long>(n*opt.min_time/std::max(t, 1e-9)*1.2));
+        std::vector<double> times;
+        for (int r=0; r<opt.repeats; r++)
+            times.push_back(measure(n)/n*1e9);
+        std::sort(times.begin(), times.end());
+        results.push_back({name, n, times[times.size()/2]});
+        std::printf("%-48s %12lld iterations %16.1f ns/op\n", name.c_str(), n, results.back().ns_per_op);
+        std::fflush(stdout);
+    }
+};
+
+struct FlatShader : IShader { // the cheapest possible fragment shader, isolates the cost of rasterize() itself
+    virtual std::pair<bool,TGAColor> fragment(const vec3 bar) const {
+        return {false, TGAColor{static_cast<std::uint8_t>(bar.x*255), static_cast<std::uint8_t>(bar.y*255), static_cast<std::uint8_t>(bar.z*255), 255}};
+    }
+};
+
+static std::vector<int> thread_counts() {
+#ifdef _OPENMP
+    std::vector<int> ret;
+    int nmax = omp_get_max_threads();
+    for (int t=1; t<nmax; t*=2) ret.push_back(t);
+    ret.push_back(nmax);
+    return ret;
+#else
+    return {1};
+#endif
+}
+
+static void set_threads(const int n) {
+#ifdef _OPENMP
+    omp_set_num_threads(n);
+#else
+    (void)n;
+#endif
+}
+
+static void bench_geometry(Bench &b) {
+    std::mt19937 gen(0);
+    std::uniform_real_distribution<double> rnd(-1., 1.);
+    mat<4,4> A, B;
+    for (int i : {0,1,2,3})
+        for (int j : {0,1,2,3}) {
+            A[i][j] = rnd(gen) + (i==j ? 4. : 0.); // diagonally dominant, hence invertible
+            B[i][j] = rnd(gen) + (i==j ? 4. : 0.);
+        }
+    vec4 v = {rnd(gen), rnd(gen), rnd(gen), rnd(gen)};
+
+    b.run("micro/mat44_multiply", [&]() {
+        escape(A);
+        escape(B);
+        mat<4,4> C = A*B;
+        escape(C);
+    });
+    b.run("micro/mat44_invert_transpose", [&]() {
+        escape(A);
+        mat<4,4> C = A.invert_transpose();
+        escape(C);
+    });
+    b.run("micro/vec4_normalized", [&]() {
+        escape(v);
+        vec4 n = normalized(v);
+        escape(n);
+    });
+}
+
+static void bench_rasterize(Bench &b) {
+    constexpr int width  = 512;
+    constexpr int height = 512;
+    struct Distribution { std::string name; double min_size, max_size; int ntris; }; // circumradii of equilateral triangles in pixels, fewer big triangles to keep the batches comparable
+    for (const Distribution &d : { Distribution{"tiny", 1, 4, 10000}, Distribution{"small", 4, 32, 1000}, Distribution{"medium", 32, 128, 100}, Distribution{"large", 128, 512, 10} }) {
+        const int ntris = d.ntris;
+        std::string name = "micro/rasterize_" + d.name;
+        if (!b.selected(name)) continue;
+        std::mt19937 gen(0);
+        std::uniform_real_distribution<double> center(-1., 1.), size(d.min_size, d.max_size), angle(0, 2*std::numbers::pi), depth(-1., 1.);
+        std::vector<vec4> tris; // flattened triangles in clip coordinates, w=1
+        for (int t=0; t<ntris; t++) {
+            vec2 c = {center(gen), center(gen)};
+            double s = size(gen) * 2 / width; // the viewport maps [-1,1] to width pixels
+            double a = angle(gen), z = depth(gen);
+            vec4 tri[3];
+            for (int v : {0,1,2})
+                tri[v] = {c.x + s*std::cos(a + v*2*std::numbers::pi/3), c.y + s*std::sin(a + v*2*std::numbers::pi/3), z, 1.}; // counter-clockwise, area >= 1.3 pixels: survives the culling
+            tris.insert(tris.end(), tri, tri+3);
+        }
+        init_viewport(0, 0, width, height);
+        TGAImage framebuffer(width, height, TGAImage::RGB);
+        FlatShader shader;
+        set_threads(1);
+        b.run(name, [&]() {
+            init_zbuffer(width, height);
+            for (int t=0; t<ntris; t++)
+                rasterize({tris[t*3+0], tris[t*3+1], tris[t*3+2]}, shader, framebuffer);
+        });
+        set_threads(thread_counts().back());
+    }
+}
+
+static void bench_fragment(Bench &b) {
+    if (!b.selected("micro/phong_fragment")) return;
+    Model model(b.opt.obj_dir + "/african_head/african_head.obj");
+    if (!model.nfaces()) {
+        std::printf("micro/phong_fragment: skipped, can't load the model\n");
+        return;
+    }
+    lookat({-1, 0, 2}, {0, 0, 0}, {0, 1, 0});
+    init_perspective(norm(vec3{-1, 0, 2}));
+    PhongShader shader({1, 1, 1}, model);
+    int face = 0;
+    for (int v : {0,1,2}) shader.vertex(face, v);
+    b.run("micro/phong_fragment", [&]() {
+        auto [discard, color] = shader.fragment({.2, .3, .5});
+        sink = sink + color[0];
+    });
+}
+
+static void bench_tga(Bench &b) {
+    constexpr int width  = 1024;
+    constexpr int height = 1024;
+    TGAImage img(width, height, TGAImage::RGB);
+    std::mt19937 gen(0);
+    std::uniform_int_distribution<int> run(1, 64), channel(0, 255);
+    for (int p=0; p<width*height; ) { // runs of identical pixels, similar to a typical render
+        TGAColor c = {static_cast<std::uint8_t>(channel(gen)), static_cast<std::uint8_t>(channel(gen)), static_cast<std::uint8_t>(channel(gen)), 255};
+        for (int r=run(gen); r-- && p<width*height; p++)
+            img.set(p%width, p/width, c);
+    }
+    const std::string raw = (std::filesystem::temp_directory_path() / "tinyrenderer_bench_raw.tga").string();
+    const std::string rle = (std::filesystem::temp_directory_path() / "tinyrenderer_bench_rle.tga").string();
+    b.run("micro/tga_write_raw", [&]() { img.write_tga_file(raw, true, false); });
+    b.run("micro/tga_write_rle", [&]() { img.write_tga_file(rle, true, true);  });
+    img.write_tga_file(raw, true, false);
+    img.write_tga_file(rle, true, true);
+    b.run("micro/tga_read_raw", [&]() { TGAImage tmp; tmp.read_tga_file(raw); sink = sink + tmp.width(); });
+    b.run("micro/tga_read_rle", [&]() { TGAImage tmp; tmp.read_tga_file(rle); sink = sink + tmp.width(); });
+    std::filesystem::remove(raw);
+    std::filesystem::remove(rle);
+}
+
+static void bench_scenes(Bench &b) {
+    const std::map<std::string, std::vector<std::string>> scenes = {
+        {"african_head", {"african_head/african_head.obj", "african_head/african_head_eye_inner.obj"}},
+        {"diablo3_pose", {"diablo3_pose/diablo3_pose.obj", "floor.obj"}},
+        {"boggie",       {"boggie/body.obj", "boggie/head.obj", "boggie/eyes.obj"}},
+    };
+    constexpr int sizes[] = {256, 800, 2048}; // square output images
+    for (const auto &entry : scenes) {
+        const std::string &scene = entry.first;
+        const std::vector<std::string> &files = entry.second;
+        auto name = [&scene](int size, int threads) {
+            return "scene/" + scene + "/" + std::to_string(size) + "x" + std::to_string(size) + "/threads:" + std::to_string(threads);
+        };
+        bool any = false;
+        for (int size : sizes)
+            for (int threads : thread_counts())
+                any = any || b.selected(name(size, threads));
+        if (!any) continue;
+        std::vector<std::unique_ptr<Model>> models; // the loading is not timed, we measure the frame rendering only
+        for (const std::string &f : files)
+            models.push_back(std::make_unique<Model>(b.opt.obj_dir + "/" + f));
+        if (std::any_of(models.begin(), models.end(), [](const auto &m) { return !m->nfaces(); })) {
+            std::printf("scene/%s: skipped, can't load the models\n", scene.c_str());
+            continue;
+        }
+        for (int size : sizes) {
+            for (int threads : thread_counts()) {
+                constexpr vec3  light{ 1, 1, 1}; // same setup as in main.cpp
+                constexpr vec3    eye{-1, 0, 2};
+                constexpr vec3 center{ 0, 0, 0};
+                constexpr vec3     up{ 0, 1, 0};
+                lookat(eye, center, up);
+                init_perspective(norm(eye-center));
+                init_viewport(size/16, size/16, size*7/8, size*7/8);
+                set_threads(threads);
+                b.run(name(size, threads), [&]() {
+                    init_zbuffer(size, size);
+                    TGAImage framebuffer(size, size, TGAImage::RGB, {177, 195, 209, 255});
+                    for (const auto &model : models) {
+                        PhongShader shader(light, *model);
+                        for (int f=0; f<model->nfaces(); f++) {
+                            Triangle clip = { shader.vertex(f, 0), shader.vertex(f, 1), shader.vertex(f, 2) };
+                            rasterize(clip, shader, framebuffer);
+                        }
+                    }
+                });
+            }
+        }
+        set_threads(thread_counts().back());
+    }
+}
+
+static void bench_tiled(Bench &b) { // end to end runs of the renderer on a poster-sized image, split between worker processes
+#ifdef BENCH_RENDERER
+    // N.B. the renderer is run as a separate program: fork() is not safe in a process that has already run OpenMP threads, like this one
+    constexpr int size = 8192;
+    std::vector<int> workers;
+    int nprocs = std::max(1u, std::thread::hardware_concurrency());
+    for (int n=1; n<nprocs; n*=2) workers.push_back(n);
+    workers.push_back(nprocs);
+    auto name = [&](int n) {
+        return "scene/tiled/diablo3_pose/" + std::to_string(size) + "x" + std::to_string(size) + "/workers:" + std::to_string(n);
+    };
+    if (std::none_of(workers.begin(), workers.end(), [&](int n) { return b.selected(name(n)); })) return;
+    const std::vector<std::string> files = { b.opt.obj_dir + "/diablo3_pose/diablo3_pose.obj", b.opt.obj_dir + "/floor.obj" };
+    for (const std::string &f : files) // the renderer happily renders empty models, check them beforehand
+        if (!Model(f).nfaces()) {
+            std::printf("scene/tiled: skipped, can't load the models\n");
+            return;
+        }
+    const std::filesystem::path dir = std::filesystem::temp_directory_path() / "tinyrenderer_bench_tiled"; // receives framebuffer.tga
+    std::filesystem::create_directories(dir);
+    for (int n : workers) {
+        if (!b.selected(name(n))) continue;
+        std::string cmd = "cd \"" + dir.string() + "\" && \"" BENCH_RENDERER "\" --size " + std::to_string(size) + "x" + std::to_string(size)
+                        + " --workers " + std::to_string(n) + " \"" + files[0] + "\" \"" + files[1] + "\" >/dev/null 2>&1";
+        if (std::system(cmd.c_str())) { // a failed run takes no time, do not let the calibration mistake it for a fast one
+            std::printf("%s: failed\n", name(n).c_str());
+            continue;
+        }
+        bool failed = false;
+        b.run(name(n), [&]() { if (std::system(cmd.c_str())) failed = true; });
+        if (failed) {
+            b.results.pop_back();
+            std::printf("%s: failed\n", name(n).c_str());
+        }
+    }
+    std::filesystem::remove_all(dir);
+#else
+    (void)b;
+#endif
+}
+
+static bool write_json(const std::string &filename, const std::vector<Result> &results) {
+    std::ofstream out(filename);
+    if (!out.is_open()) {
+        std::cerr << "can't open file " << filename << "\n";
+        return false;
+    }
+    out << std::fixed << std::setprecision(1);
+    out << "{\n  \"benchmarks\": [\n"; // one benchmark per line, read_json() relies on it
+    for (size_t i=0; i<results.size(); i++)
+        out << "    {\"name\": \"" << results[i].name << "\", \"iterations\": " << results[i].iterations
+            << ", \"ns_per_op\": " << results[i].ns_per_op << "}" << (i+1<results.size() ? "," : "") << "\n";
+    out << "  ]\n}\n";
+    return out.good();
+}
+
+static bool read_json(const std::string &filename, std::map<std::string, double> &baseline) {
+    std::ifstream in(filename);
+    if (!in.is_open()) {
+        std::cerr << "can't open file " << filename << "\n";
+        return false;
+    }
+    const std::regex entry(R"re("name":\s*"([^"]*)".*"ns_per_op":\s*([-+0-9.eE]+))re");
+    std::string line;
+    while (std::getline(in, line)) {
+        std::smatch m;
+        if (std::regex_search(line, m, entry))
+            baseline[m[1]] = std::stod(m[2]);
+    }
+    return true;
+}
+
+static int compare(const std::vector<Result> &results, const std::map<std::string, double> &baseline, const Options &opt) {
+    int nregressions = 0, nmissing = 0;
+    std::printf("\n%-48s %14s %14s %9s\n", "benchmark", "baseline ns", "current ns", "change");
+    for (const Result &r : results) {
+        auto it = baseline.find(r.name);
+        if (it==baseline.end()) {
+            std::printf("%-48s %14s %14.1f %9s\n", r.name.c_str(), "-", r.ns_per_op, "new");
+            continue;
+        }
+        double change = r.ns_per_op/it->second - 1.;
+        bool regression = change > opt.threshold;
+        nregressions += regression;
+        std::printf("%-48s %14.1f %14.1f %+8.1f%%%s\n", r.name.c_str(), it->second, r.ns_per_op, change*100., regression ? "  REGRESSION" : "");
+    }
+    for (const auto &[name, ns] : baseline) { // a renamed, skipped or crashed benchmark must not pass unnoticed
+        if (name.find(opt.filter)==std::string::npos) continue;
+        if (std::any_of(results.begin(), results.end(), [&name](const Result &r) { return r.name==name; })) continue;
+        std::printf("%-48s %14.1f %14s %9s  MISSING\n", name.c_str(), ns, "-", "");
+        nmissing++;
+    }
+    std::printf("\n%d regression(s) above %.0f%%, %d missing benchmark(s)\n", nregressions, opt.threshold*100., nmissing);
+    return nregressions + nmissing;
+}
+
+int main(int argc, char** argv) {
+    Options opt;
+    for (int i=1; i<argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i+1<argc;
+        if      (arg=="--filter"    && has_value) opt.filter    = argv[++i];
+        else if (arg=="--obj-dir"   && has_value) opt.obj_dir   = argv[++i];
+        else if (arg=="--json"      && has_value) opt.json      = argv[++i];
+        else if (arg=="--compare"   && has_value) opt.baseline  = argv[++i];
+        else if (arg=="--min-time"  && has_value) opt.min_time  = std::stod(argv[++i]);
+        else if (arg=="--threshold" && has_value) opt.threshold = std::stod(argv[++i]);
+        else if (arg=="--repeats"   && has_value) opt.repeats   = std::max(1, std::stoi(argv[++i]));
+        else {
+            std::cerr << "Usage: " << argv[0] << " [--filter substring] [--obj-dir dir] [--json results.json] [--compare baseline.json]"
+                      << " [--min-time seconds] [--threshold fraction] [--repeats n]" << std::endl;
+            return 1;
+        }
+    }
+
+    std::map<std::string, double> baseline;
+    if (!opt.baseline.empty() && !read_json(opt.baseline, baseline)) return 1;
+
+    std::stringstream log;                          // the renderer is chatty (model and texture loading),
+    std::streambuf *cerrbuf = std::cerr.rdbuf(log.rdbuf()); // mute it for the benchmarks
+
+    Bench b{opt};
+    bench_geometry(b);
+    bench_rasterize(b);
+    bench_fragment(b);
+    bench_tga(b);
+    bench_scenes(b);
+    bench_tiled(b);
+
+    std::cerr.rdbuf(cerrbuf);
+    if (!opt.json.empty() && !write_json(opt.json, b.results)) return 1;
+    if (!opt.baseline.empty() && compare(b.results, baseline, opt)) return 2;
+    return 0;
+}
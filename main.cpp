@@ -1,57 +1,25 @@
-#include "our_gl.h"
-#include "model.h"
-
-extern mat<4,4> ModelView, Perspective; // "OpenGL" state matrices and
-extern std::vector<double> zbuffer;     // the depth buffer
-
-struct PhongShader : IShader {
-    const Model &model;
-    vec4 l;              // light direction in eye coordinates
-    vec2  varying_uv[3]; // triangle uv coordinates, written by the vertex shader, read by the fragment shader
-    vec4 varying_nrm[3]; // normal per vertex to be interpolated by the fragment shader
-    vec4 tri[3];         // triangle in view coordinates
-
-    PhongShader(const vec3 light, const Model &m) : model(m) {
-        l = normalized((ModelView*vec4{light.x, light.y, light.z, 0.})); // transform the light vector to view coordinates
-    }
-
-    virtual vec4 vertex(const int face, const int vert) {
-        varying_uv[vert]  = model.uv(face, vert);
-        varying_nrm[vert] = ModelView.invert_transpose() * model.normal(face, vert);
-        vec4 gl_Position = ModelView * model.vert(face, vert);
-        tri[vert] = gl_Position;
-        return Perspective * gl_Position;                         // in clip coordinates
-    }
-
-    virtual std::pair<bool,TGAColor> fragment(const vec3 bar) const {
-        mat<2,4> E = { tri[1]-tri[0], tri[2]-tri[0] };
-        mat<2,2> U = { varying_uv[1]-varying_uv[0], varying_uv[2]-varying_uv[0] };
-        mat<2,4> T = U.invert() * E;
-        mat<4,4> D = {normalized(T[0]),  // tangent vector
-                      normalized(T[1]),  // bitangent vector
-                      normalized(varying_nrm[0]*bar[0] + varying_nrm[1]*bar[1] + varying_nrm[2]*bar[2]), // interpolated normal
-                      {0,0,0,1}}; // Darboux frame
-        vec2 uv = varying_uv[0] * bar[0] + varying_uv[1] * bar[1] + varying_uv[2] * bar[2];
-        vec4 n = normalized(D.transpose() * model.normal(uv));
-        vec4 r = normalized(n * (n * l)*2 - l);                   // reflected light direction
-        double ambient  = .4;                                     // ambient light intensity
-        double diffuse  = 1.*std::max(0., n * l);                 // diffuse light intensity
-        double specular = (.5+2.*sample2D(model.specular(), uv)[0]/255.) * std::pow(std::max(r.z, 0.), 35);  // specular intensity, note that the camera lies on the z-axis (in eye coordinates), therefore simple r.z, since (0,0,1)*(r.x, r.y, r.z) = r.z
-        TGAColor gl_FragColor = sample2D(model.diffuse(), uv);
-        for (int channel : {0,1,2})
-            gl_FragColor[channel] = std::min<int>(255, gl_FragColor[channel]*(ambient + diffuse + specular));
-        return {false, gl_FragColor};                             // do not discard the pixel
-    }
-};
+#include <cstdio>
+#include <numeric>
+#include "phong.h"
+#include "profile.h"
+#include "tiles.h"
 
 int main(int argc, char** argv) {
-    if (argc < 2) {
-        std::cerr << "Usage: " << argv[0] << " obj/model.obj" << std::endl;
+    int width    = 800;              // output image size
+    int height   = 800;
+    int nworkers = 1;                // number of worker processes, each one renders a tile of the image
+    int argi = 1;
+    for (; argi+1<argc && argv[argi][0]=='-'; argi+=2) {
+        std::string opt = argv[argi];
+        if (opt=="--size" && 2==std::sscanf(argv[argi+1], "%dx%d", &width, &height) && width>0 && height>0) continue;
+        if (opt=="--workers" && 1==std::sscanf(argv[argi+1], "%d", &nworkers) && nworkers>0) continue;
+        argi = argc;                 // unknown option, print the usage
+    }
+    if (argi >= argc) {
+        std::cerr << "Usage: " << argv[0] << " [--size 800x800] [--workers 1] obj/model.obj" << std::endl;
         return 1;
     }
 
-    constexpr int width  = 800;      // output image size
-    constexpr int height = 800;
     constexpr vec3  light{ 1, 1, 1}; // light source
     constexpr vec3    eye{-1, 0, 2}; // camera position
     constexpr vec3 center{ 0, 0, 0}; // camera direction
@@ -60,21 +28,61 @@ int main(int argc, char** argv) {
     lookat(eye, center, up);                                   // build the ModelView   matrix
     init_perspective(norm(eye-center));                        // build the Perspective matrix
     init_viewport(width/16, height/16, width*7/8, height*7/8); // build the Viewport    matrix
-    init_zbuffer(width, height);
-    TGAImage framebuffer(width, height, TGAImage::RGB, {177, 195, 209, 255});
 
-    for (int m=1; m<argc; m++) {                    // iterate through all input objects
-        Model model(argv[m]);                       // load the data
-        PhongShader shader(light, model);
-        for (int f=0; f<model.nfaces(); f++) {      // iterate through all facets
-            Triangle clip = { shader.vertex(f, 0),  // assemble the primitive
-                              shader.vertex(f, 1),
-                              shader.vertex(f, 2) };
-            rasterize(clip, shader, framebuffer);   // rasterize the primitive
+    std::vector<Model> models;
+    models.reserve(argc-argi);
+    for (int m=argi; m<argc; m++)                   // load all input objects before forking the workers
+        models.emplace_back(argv[m]);
+
+    std::vector<Tile> tiles = split_screen(width, height, nworkers);
+    std::vector<std::vector<std::vector<int>>> bins(tiles.size(), std::vector<std::vector<int>>(models.size())); // bins[t][m] are the facets of the model m overlapping the tile t
+    if (tiles.size()==1) {
+        for (int m=0; m<static_cast<int>(models.size()); m++) { // a single tile gets all the facets, no need to sort them
+            bins[0][m].resize(models[m].nfaces());
+            std::iota(bins[0][m].begin(), bins[0][m].end(), 0);
+        }
+    } else {
+        PROFILE_SCOPE(TRIANGLE_SETUP);
+        for (int m=0; m<static_cast<int>(models.size()); m++) {
+            for (int f=0; f<models[m].nfaces(); f++) {          // sort-first: dispatch the facets by their screen bounding box
+                PROFILE_COUNT(TRIANGLES_SUBMITTED);             // counted once here, the workers count them once per tile
+                Triangle clip;                                  // same arithmetic as PhongShader::vertex(), the workers must take the same culling decision
+                for (int v : {0,1,2}) clip[v] = Perspective * (ModelView * models[m].vert(f, v));
+                vec2 bbmin, bbmax;
+                if (!bounding_box(clip, bbmin, bbmax)) {        // culled, no tile would draw it
+                    PROFILE_COUNT(TRIANGLES_CULLED);
+                    continue;
+                }
+                for (int t=0; t<static_cast<int>(tiles.size()); t++)
+                    if (bbmax.x>tiles[t].x-1 && bbmin.x<tiles[t].x+tiles[t].w && bbmax.y>tiles[t].y-1 && bbmin.y<tiles[t].y+tiles[t].h)
+                        bins[t][m].push_back(f);
+            }
         }
     }
 
-    framebuffer.write_tga_file("framebuffer.tga");
+    auto render_tile = [&](const int t, TGAImage &image) {
+        init_scissor(tiles[t].x, tiles[t].y, tiles[t].w, tiles[t].h); // keep the full screen viewport, the pixels match the single tile render exactly
+        init_zbuffer(image.width(), image.height());
+        for (int m=0; m<static_cast<int>(models.size()); m++) { // iterate through all input objects
+            PhongShader shader(light, models[m]);
+            for (int f : bins[t][m]) {                  // iterate through the facets overlapping the tile
+                PROFILE_TIMER(vertex_timer, VERTEX_SHADING);
+                Triangle clip = { shader.vertex(f, 0),  // assemble the primitive
+                                  shader.vertex(f, 1),
+                                  shader.vertex(f, 2) };
+                PROFILE_STOP(vertex_timer);
+                rasterize(clip, shader, image);         // rasterize the primitive
+            }
+        }
+    };
+    TGAImage framebuffer;
+    if (!render_tiled(framebuffer, width, height, {177, 195, 209, 255}, tiles, render_tile)) return 1;
+
+    {
+        PROFILE_SCOPE(IMAGE_WRITE);
+        framebuffer.write_tga_file("framebuffer.tga");
+    }
+    PROFILE_WRITE_HEATMAPS("overdraw.tga", "shading_cost.tga");
+    PROFILE_REPORT(std::cout);                      // per-frame timings and counters, one line of JSON
     return 0;
 }
-
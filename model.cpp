@@ -1,8 +1,10 @@
 #include <fstream>
 #include <sstream>
 #include "model.h"
+#include "profile.h"
 
 Model::Model(const std::string filename) {
+    PROFILE_TIMER(load_timer, MODEL_LOAD);
     std::ifstream in;
     in.open(filename, std::ifstream::in);
     if (in.fail()) return;
@@ -42,10 +44,12 @@ Model::Model(const std::string filename) {
         }
     }
     std::cerr << "# v# " << nverts() << " f# "  << nfaces() << std::endl;
+    PROFILE_STOP(load_timer);
     auto load_texture = [&filename](const std::string suffix, TGAImage &img) {
         size_t dot = filename.find_last_of(".");
         if (dot==std::string::npos) return;
         std::string texfile = filename.substr(0,dot) + suffix;
+        PROFILE_SCOPE(TEXTURE_DECODE);
         std::cerr << "texture file " << texfile << " loading " << (img.read_tga_file(texfile.c_str()) ? "ok" : "failed") << std::endl;
     };
     load_texture("_diffuse.tga",    diffusemap );
@@ -1,8 +1,11 @@
 #include <algorithm>
+#include <limits>
 #include "our_gl.h"
+#include "profile.h"
 
 mat<4,4> ModelView, Viewport, Perspective; // "OpenGL" state matrices
 std::vector<double> zbuffer;               // depth buffer
+static struct { int x, y, w, h; } scissor = { 0, 0, std::numeric_limits<int>::max(), std::numeric_limits<int>::max() }; // scissor rectangle, the whole screen by default
 
 void lookat(const vec3 eye, const vec3 center, const vec3 up) {
     vec3 n = normalized(eye-center);
@@ -20,33 +23,68 @@ void init_viewport(const int x, const int y, const int w, const int h) {
     Viewport = {{{w/2., 0, 0, x+w/2.}, {0, h/2., 0, y+h/2.}, {0,0,1,0}, {0,0,0,1}}};
 }
 
+void init_scissor(const int x, const int y, const int w, const int h) {
+    scissor = { x, y, w, h };
+}
+
 void init_zbuffer(const int width, const int height) {
     zbuffer = std::vector(width*height, -1000.);
+    PROFILE_HEATMAP_INIT(width, height);
+}
+
+bool bounding_box(const Triangle &clip, vec2 &bbmin, vec2 &bbmax) {
+    vec2 screen[3] = { (Viewport*(clip[0]/clip[0].w)).xy(), (Viewport*(clip[1]/clip[1].w)).xy(), (Viewport*(clip[2]/clip[2].w)).xy() };
+    mat<3,3> ABC = {{ {screen[0].x, screen[0].y, 1.}, {screen[1].x, screen[1].y, 1.}, {screen[2].x, screen[2].y, 1.} }};
+    auto [minx,maxx] = std::minmax({screen[0].x, screen[1].x, screen[2].x});
+    auto [miny,maxy] = std::minmax({screen[0].y, screen[1].y, screen[2].y});
+    bbmin = {minx, miny};
+    bbmax = {maxx, maxy};
+    return ABC.det()>=1; // same test as in rasterize()
 }
 
 void rasterize(const Triangle &clip, const IShader &shader, TGAImage &framebuffer) {
+    PROFILE_COUNT(TRIANGLES_SUBMITTED);
+    PROFILE_TIMER(setup_timer, TRIANGLE_SETUP);
     vec4 ndc[3]    = { clip[0]/clip[0].w, clip[1]/clip[1].w, clip[2]/clip[2].w };                // normalized device coordinates
     vec2 screen[3] = { (Viewport*ndc[0]).xy(), (Viewport*ndc[1]).xy(), (Viewport*ndc[2]).xy() }; // screen coordinates
 
     mat<3,3> ABC = {{ {screen[0].x, screen[0].y, 1.}, {screen[1].x, screen[1].y, 1.}, {screen[2].x, screen[2].y, 1.} }};
-    if (ABC.det()<1) return; // backface culling + discarding triangles that cover less than a pixel
+    if (ABC.det()<1) {       // backface culling + discarding triangles that cover less than a pixel
+        PROFILE_COUNT(TRIANGLES_CULLED);
+        return;
+    }
 
     auto [bbminx,bbmaxx] = std::minmax({screen[0].x, screen[1].x, screen[2].x}); // bounding box for the triangle
     auto [bbminy,bbmaxy] = std::minmax({screen[0].y, screen[1].y, screen[2].y}); // defined by its top left and bottom right corners
+    PROFILE_STOP(setup_timer);
+    const int w = std::min(scissor.w, framebuffer.width()), h = std::min(scissor.h, framebuffer.height()); // the part of the scissor rectangle held by the framebuffer
 #pragma omp parallel for
-    for (int x=std::max<int>(bbminx, 0); x<=std::min<int>(bbmaxx, framebuffer.width()-1); x++) {         // clip the bounding box by the screen
-        for (int y=std::max<int>(bbminy, 0); y<=std::min<int>(bbmaxy, framebuffer.height()-1); y++) {
+    for (int x=std::max<int>(bbminx, scissor.x); x<=std::min<int>(bbmaxx, scissor.x+w-1); x++) {         // clip the bounding box by the scissor rectangle
+        PROFILE_SCOPE(RASTERIZATION);
+        for (int y=std::max<int>(bbminy, scissor.y); y<=std::min<int>(bbmaxy, scissor.y+h-1); y++) {
             vec3 bc_screen = ABC.invert_transpose() * vec3{static_cast<double>(x), static_cast<double>(y), 1.}; // barycentric coordinates of {x,y} w.r.t the triangle
             vec3 bc_clip   = { bc_screen.x/clip[0].w, bc_screen.y/clip[1].w, bc_screen.z/clip[2].w };     // check https://github.com/ssloy/tinyrenderer/wiki/Technical-difficulties-linear-interpolation-with-perspective-deformations
             bc_clip = bc_clip / (bc_clip.x + bc_clip.y + bc_clip.z);
             if (bc_screen.x<0 || bc_screen.y<0 || bc_screen.z<0) continue; // negative barycentric coordinate => the pixel is outside the triangle
             double z = bc_screen * vec3{ ndc[0].z, ndc[1].z, ndc[2].z };   // linear interpolation of the depth
-            if (z <= zbuffer[x+y*framebuffer.width()]) continue;   // discard fragments that are too deep w.r.t the z-buffer
+            int fx = x-scissor.x, fy = y-scissor.y;                        // the pixel in the framebuffer
+            PROFILE_COUNT(FRAGMENTS_TESTED);
+            PROFILE_OVERDRAW(fx, fy);
+            if (z <= zbuffer[fx+fy*framebuffer.width()]) {        // discard fragments that are too deep w.r.t the z-buffer
+                PROFILE_COUNT(FRAGMENTS_DEPTH_FAILED);
+                continue;
+            }
+            PROFILE_FRAGMENT_TIMER(fragment_timer);
             auto [discard, color] = shader.fragment(bc_clip);
-            if (discard) continue;                                 // fragment shader can discard current fragment
-            zbuffer[x+y*framebuffer.width()] = z;                  // update the z-buffer
-            framebuffer.set(x, y, color);                          // update the framebuffer
+            PROFILE_STOP(fragment_timer);
+            PROFILE_SHADING_COST(fx, fy, fragment_timer);
+            if (discard) {                                         // fragment shader can discard current fragment
+                PROFILE_COUNT(FRAGMENTS_DISCARDED);
+                continue;
+            }
+            PROFILE_COUNT(FRAGMENTS_SHADED);
+            zbuffer[fx+fy*framebuffer.width()] = z;                // update the z-buffer
+            framebuffer.set(fx, fy, color);                        // update the framebuffer
         }
     }
 }
-
@@ -5,6 +5,7 @@ void lookat(const vec3 eye, const vec3 center, const vec3 up);
 void init_perspective(const double f);
 void init_viewport(const int x, const int y, const int w, const int h);
 void init_zbuffer(const int width, const int height);
+void init_scissor(const int x, const int y, const int w, const int h); // draw only the pixels inside the rectangle, the framebuffer holds the rectangle, its bottom left corner is (x,y)
 
 struct IShader {
     static TGAColor sample2D(const TGAImage &img, const vec2 &uvf) {
@@ -14,5 +15,6 @@ struct IShader {
 };
 
 typedef vec4 Triangle[3]; // a triangle primitive is made of three ordered points
+bool bounding_box(const Triangle &clip, vec2 &bbmin, vec2 &bbmax); // screen coordinates of the corners, false if rasterize() would cull the triangle
 void rasterize(const Triangle &clip, const IShader &shader, TGAImage &framebuffer);
 
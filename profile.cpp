@@ -0,0 +1,163 @@
+#ifdef INSTRUMENT
+#include <algorithm>
+#include <mutex>
+#include <vector>
+#include "profile.h"
+#ifdef HEATMAP
+#include "tgaimage.h"
+#endif
+
+namespace profile {
+    static std::mutex registry_mutex;               // taken once per thread at registration, and at the end of a frame
+    static std::vector<ThreadStats*> registry = {}; // stats of all the live threads
+    static ThreadStats retired = {};                // stats accumulated by the threads that have exited
+    static int frame = 0;
+
+    static std::vector<Frame> tiles = {};           // frames of the tiles rendered by the workers, indexed by the tile
+    static Frame tiled = {};                        // and their sum, without the triangle counters: the coordinator counts the triangles while binning
+
+    static void add(ThreadStats &total, const ThreadStats &stats) {
+        for (int i=NSTAGES;   i--; total.ns[i]    += stats.ns[i]);
+        for (int i=NCOUNTERS; i--; total.count[i] += stats.count[i]);
+        total.fragments_seen  += stats.fragments_seen;
+        total.fragments_timed += stats.fragments_timed;
+    }
+
+    struct Retire { // folds the stats of an exiting thread into the retired ones
+        ThreadStats *stats = nullptr;
+        ~Retire() {
+            if (!stats) return;
+            std::lock_guard<std::mutex> lock(registry_mutex);
+            add(retired, *stats);
+            registry.erase(std::find(registry.begin(), registry.end(), stats));
+        }
+    };
+    static thread_local Retire retire;
+
+    void register_thread(ThreadStats &stats) {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        stats.registered = true;
+        registry.push_back(&stats);
+        retire.stats = &stats;
+    }
+
+    Frame take() { // N.B. must not be called while other threads are rendering
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        Frame total = { retired, static_cast<std::int64_t>(registry.size()) };
+        for (ThreadStats *stats : registry) {
+            add(total.stats, *stats);
+            *stats = {};                // reset for the next frame,
+            stats->registered = true;   // keep it registered
+        }
+        retired = {};
+        return total;
+    }
+
+    void merge(const Frame &frame) {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        add(retired, frame.stats);
+    }
+
+    void merge_tile(const int tile, const Frame &frame) {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        if (tile>=static_cast<int>(tiles.size())) tiles.resize(tile+1);
+        tiles[tile] = frame;
+        ThreadStats stats = frame.stats;
+        stats.count[TRIANGLES_SUBMITTED] = stats.count[TRIANGLES_CULLED] = 0; // a triangle spanning several tiles is submitted to each of them
+        add(tiled.stats, stats);
+        tiled.nthreads += frame.nthreads;
+    }
+
+    void reset() {
+        take();
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        tiles = {};
+        tiled = {};
+    }
+
+    static void print(std::ostream &out, const Frame &frame) { // "threads", "stages_ms" and "counters" of a frame
+        constexpr const char *stage_names[NSTAGES] = { "model_load", "texture_decode", "vertex_shading", "triangle_setup", "rasterization", "fragment_shading", "image_write" };
+        constexpr const char *counter_names[NCOUNTERS] = { "triangles_submitted", "triangles_culled", "fragments_tested", "fragments_depth_failed", "fragments_discarded", "fragments_shaded" };
+        ThreadStats total = frame.stats;
+        if (total.fragments_timed)                             // extrapolate the sampled fragments to all of them
+            total.ns[FRAGMENT_SHADING] = total.ns[FRAGMENT_SHADING] * static_cast<double>(total.fragments_seen) / total.fragments_timed;
+        total.ns[RASTERIZATION] -= total.ns[FRAGMENT_SHADING]; // the fragment shader is called from within the rasterization timer, make the stages disjoint
+
+        out << "\"threads\": " << frame.nthreads << ", \"stages_ms\": {";
+        for (int i=0; i<NSTAGES; i++)
+            out << (i ? ", " : "") << "\"" << stage_names[i] << "\": " << total.ns[i]/1e6;
+        out << "}, \"counters\": {";
+        for (int i=0; i<NCOUNTERS; i++)
+            out << (i ? ", " : "") << "\"" << counter_names[i] << "\": " << total.count[i];
+        out << "}";
+    }
+
+    void report(std::ostream &out) {
+        Frame total = take();
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        add(total.stats, tiled.stats);
+        total.nthreads += tiled.nthreads;
+
+        // times are summed over all the threads (and workers), rasterization and fragment shading run in parallel and their sum can exceed the wall time
+        out << "{\"frame\": " << frame++ << ", ";
+        print(out, total);
+        if (!tiles.empty()) {
+            out << ", \"tiles\": [";
+            for (int i=0; i<static_cast<int>(tiles.size()); i++) {
+                out << (i ? ", " : "") << "{\"tile\": " << i << ", ";
+                print(out, tiles[i]);
+                out << "}";
+            }
+            out << "]";
+        }
+        out << "}" << std::endl;
+        tiles = {};
+        tiled = {};
+    }
+
+#ifdef HEATMAP
+    static int heatmap_width = 0, heatmap_height = 0;
+    static std::vector<std::int64_t> overdraw_map = {}; // number of fragments tested per pixel
+    static std::vector<std::int64_t>     cost_map = {}; // nanoseconds spent in the fragment shader per pixel
+
+    void init_heatmap(const int width, const int height) {
+        heatmap_width  = width;
+        heatmap_height = height;
+        overdraw_map = std::vector<std::int64_t>(width*height, 0);
+        cost_map     = std::vector<std::int64_t>(width*height, 0);
+    }
+
+    std::int64_t* heatmap(const Heatmap map) {
+        return (map==OVERDRAW ? overdraw_map : cost_map).data();
+    }
+
+    // N.B. no synchronization: rasterize() hands each column of a triangle to a single thread
+    void overdraw(const int x, const int y) {
+        if (x<0 || y<0 || x>=heatmap_width || y>=heatmap_height) return;
+        overdraw_map[x+y*heatmap_width]++;
+    }
+
+    void shading_cost(const int x, const int y, const std::int64_t ns) {
+        if (x<0 || y<0 || x>=heatmap_width || y>=heatmap_height) return;
+        cost_map[x+y*heatmap_width] += ns;
+    }
+
+    static bool write_heatmap(const std::string filename, const std::vector<std::int64_t> &map) {
+        TGAImage img(heatmap_width, heatmap_height, TGAImage::RGB);
+        std::int64_t max = std::max<std::int64_t>(1, *std::max_element(map.begin(), map.end()));
+        for (int x=0; x<heatmap_width; x++)
+            for (int y=0; y<heatmap_height; y++) {
+                double t = map[x+y*heatmap_width]/static_cast<double>(max); // black -> red -> yellow -> white
+                auto ramp = [t](double offset) { return static_cast<std::uint8_t>(255*std::clamp(3*t - offset, 0., 1.)); };
+                img.set(x, y, {ramp(2), ramp(1), ramp(0), 255}); // attention, BGRA order
+            }
+        return img.write_tga_file(filename);
+    }
+
+    bool write_heatmaps(const std::string overdraw_file, const std::string cost_file) {
+        if (overdraw_map.empty()) return false;
+        return write_heatmap(overdraw_file, overdraw_map) && write_heatmap(cost_file, cost_map);
+    }
+#endif
+}
+#endif
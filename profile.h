@@ -0,0 +1,129 @@
+#pragma once
+// Pipeline instrumentation: per-stage timers, per-thread counters and per-pixel heatmaps.
+// Everything is behind the PROFILE_* macros, they expand to nothing unless INSTRUMENT is defined
+// (cmake -Dinstrument=ON), the heatmaps additionally require HEATMAP (cmake -Dheatmap=ON).
+
+#ifdef INSTRUMENT
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+namespace profile {
+    enum Stage   { MODEL_LOAD, TEXTURE_DECODE, VERTEX_SHADING, TRIANGLE_SETUP, RASTERIZATION, FRAGMENT_SHADING, IMAGE_WRITE, NSTAGES };
+    // fragments_tested = fragments_depth_failed + fragments_discarded + fragments_shaded, the latter are the ones written to the framebuffer
+    enum Counter { TRIANGLES_SUBMITTED, TRIANGLES_CULLED, FRAGMENTS_TESTED, FRAGMENTS_DEPTH_FAILED, FRAGMENTS_DISCARDED, FRAGMENTS_SHADED, NCOUNTERS };
+
+    struct alignas(64) ThreadStats { // one per thread, no sharing => no contention and no atomics
+        std::int64_t ns[NSTAGES]       = {};
+        std::int64_t count[NCOUNTERS]  = {};
+        std::int64_t fragments_seen    = 0; // fragment shader invocations seen by FragmentTimer,
+        std::int64_t fragments_timed   = 0; // and the ones it actually timed
+        bool registered = false;
+    };
+
+    inline thread_local ThreadStats thread_stats = {}; // trivially constructed, accessing it is a plain TLS load
+    void register_thread(ThreadStats &stats);          // makes the thread's stats visible to report()
+
+    inline ThreadStats& local() {
+        if (!thread_stats.registered) register_thread(thread_stats);
+        return thread_stats;
+    }
+
+    inline std::int64_t now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    struct Timer { // accumulates the time elapsed between its construction and stop() (or destruction) into a stage
+        const Stage stage;
+        const std::int64_t start = now();
+        std::int64_t ns = -1;
+        Timer(const Stage s) : stage(s) {}
+        ~Timer() { stop(); }
+        void stop() {
+            if (ns>=0) return;
+            ns = now() - start;
+            local().ns[stage] += ns;
+        }
+    };
+
+    // Reading the clock twice per fragment would cost more than a cheap fragment shader, so only one fragment
+    // out of fragment_sampling is timed, and report() extrapolates. Heatmaps need the cost of every pixel, though.
+#ifdef HEATMAP
+    constexpr int fragment_sampling = 1;
+#else
+    constexpr int fragment_sampling = 64;
+#endif
+
+    static_assert(!(fragment_sampling & (fragment_sampling-1)), "the sampling rate must be a power of two");
+
+    struct FragmentTimer {
+        ThreadStats &stats = local();
+        std::int64_t start = -1;
+        std::int64_t ns = 0;
+        FragmentTimer() {
+            if (stats.fragments_seen++ & (fragment_sampling-1)) return;
+            start = now();
+        }
+        ~FragmentTimer() { stop(); }
+        void stop() {
+            if (start<0) return;
+            ns = now() - start;
+            start = -1;
+            stats.ns[FRAGMENT_SHADING] += ns;
+            stats.fragments_timed++;
+        }
+    };
+
+    struct Frame { // the stats of all the threads of a process
+        ThreadStats stats = {};
+        std::int64_t nthreads = 0;
+    };
+
+    Frame take();                                   // sums the stats of all the threads and resets them
+    void merge(const Frame &frame);                 // adds the frame back to the current one
+    void merge_tile(const int tile, const Frame &frame); // adds the frame of a tile rendered by a worker, reported separately as well
+
+    void report(std::ostream &out); // dumps the current frame as one line of JSON, and starts a new frame
+    void reset();                   // drops the current frame
+
+#ifdef HEATMAP
+    enum Heatmap { OVERDRAW, SHADING_COST, NHEATMAPS };
+    void init_heatmap(const int width, const int height);
+    std::int64_t* heatmap(const Heatmap map);                   // the raw values of the heatmap, row by row
+    void overdraw(const int x, const int y);                    // one more fragment tested at pixel (x,y)
+    void shading_cost(const int x, const int y, const std::int64_t ns); // time spent shading pixel (x,y)
+    bool write_heatmaps(const std::string overdraw_file, const std::string cost_file);
+#endif
+}
+
+#define PROFILE_CAT_(a, b) a##b
+#define PROFILE_CAT(a, b) PROFILE_CAT_(a, b)
+#define PROFILE_SCOPE(stage)       profile::Timer PROFILE_CAT(profile_timer_, __LINE__){profile::stage}
+#define PROFILE_TIMER(name, stage) profile::Timer name{profile::stage}
+#define PROFILE_FRAGMENT_TIMER(name) profile::FragmentTimer name
+#define PROFILE_STOP(name)         name.stop()
+#define PROFILE_COUNT(counter)     (profile::local().count[profile::counter]++)
+#define PROFILE_REPORT(out)        profile::report(out)
+#define PROFILE_RESET()            profile::reset()
+#else
+#define PROFILE_SCOPE(stage)
+#define PROFILE_TIMER(name, stage)
+#define PROFILE_FRAGMENT_TIMER(name)
+#define PROFILE_STOP(name)
+#define PROFILE_COUNT(counter)
+#define PROFILE_REPORT(out)
+#define PROFILE_RESET()
+#endif
+
+#if defined(INSTRUMENT) && defined(HEATMAP)
+#define PROFILE_HEATMAP_INIT(width, height)     profile::init_heatmap(width, height)
+#define PROFILE_OVERDRAW(x, y)                  profile::overdraw(x, y)
+#define PROFILE_SHADING_COST(x, y, timer)       profile::shading_cost(x, y, timer.ns)
+#define PROFILE_WRITE_HEATMAPS(overdraw, cost)  profile::write_heatmaps(overdraw, cost)
+#else
+#define PROFILE_HEATMAP_INIT(width, height)
+#define PROFILE_OVERDRAW(x, y)
+#define PROFILE_SHADING_COST(x, y, timer)
+#define PROFILE_WRITE_HEATMAPS(overdraw, cost)
+#endif
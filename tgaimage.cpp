@@ -3,6 +3,7 @@
 #include "tgaimage.h"
 
 TGAImage::TGAImage(const int w, const int h, const int bpp, TGAColor c) : w(w), h(h), bpp(bpp), data(w*h*bpp, 0) {
+    if (!c[0] && !c[1] && !c[2] && !c[3]) return; // already zeroed
     for (int j=0; j<h; j++)
         for (int i=0; i<w; i++)
             set(i, j, c);
@@ -204,3 +205,10 @@ int TGAImage::height() const {
     return h;
 }
 
+std::uint8_t* TGAImage::buffer() {
+    return data.data();
+}
+
+const std::uint8_t* TGAImage::buffer() const {
+    return data.data();
+}
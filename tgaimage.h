@@ -39,6 +39,8 @@ struct TGAImage {
     void set(const int x, const int y, const TGAColor &c);
     int width()  const;
     int height() const;
+    std::uint8_t* buffer();             // raw pixel data, row by row, bpp bytes per pixel
+    const std::uint8_t* buffer() const;
 private:
     bool   load_rle_data(std::ifstream &in);
     bool unload_rle_data(std::ofstream &out) const;
@@ -0,0 +1,177 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#if defined(__unix__) || defined(__APPLE__)
+#include <cerrno>
+#include <sys/wait.h>
+#include <unistd.h>
+#define TILES_FORK
+#endif
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "profile.h"
+#include "tiles.h"
+
+std::vector<Tile> split_screen(const int width, const int height, const int ntiles) {
+    int cols = std::max(1, static_cast<int>(std::sqrt(ntiles*static_cast<double>(width)/height))); // aim for square tiles,
+    while (ntiles%cols) cols--;                                                                    // but do not leave holes
+    int rows = ntiles/cols;
+    std::vector<Tile> tiles;
+    for (int j=0; j<rows; j++)
+        for (int i=0; i<cols; i++) {
+            int x0 = width*i/cols, x1 = width*(i+1)/cols;
+            int y0 = height*j/rows, y1 = height*(j+1)/rows;
+            tiles.push_back({x0, y0, x1-x0, y1-y0});
+        }
+    return tiles;
+}
+
+static void blit(TGAImage &img, const Tile &tile, const TGAImage &src) { // copies src into the tile of img, both are RGB
+    for (int y=0; y<tile.h; y++)
+        std::memcpy(img.buffer() + (tile.x+(tile.y+y)*img.width())*TGAImage::RGB, src.buffer() + y*tile.w*TGAImage::RGB, tile.w*TGAImage::RGB);
+}
+
+#ifdef TILES_FORK
+static bool write_all(const int fd, const std::uint8_t *buf, size_t size) {
+    while (size) {
+        ssize_t n = write(fd, buf, size);
+        if (n<0 && errno==EINTR) continue;
+        if (n<=0) return false;
+        buf  += n;
+        size -= n;
+    }
+    return true;
+}
+
+static bool read_all(const int fd, std::uint8_t *buf, size_t size) {
+    while (size) {
+        ssize_t n = read(fd, buf, size);
+        if (n<0 && errno==EINTR) continue;
+        if (n<=0) return false;
+        buf  += n;
+        size -= n;
+    }
+    return true;
+}
+
+// worker side: render the tile and send its pixels (RGB, row by row) through the pipe, followed by its stats if instrumented
+static void worker(const std::vector<Tile> &tiles, const int itile, const TGAColor background, const std::function<void(const int, TGAImage &)> &render_tile, const int fd) {
+#ifdef _OPENMP
+    omp_set_num_threads(std::max(1, omp_get_num_procs()/static_cast<int>(tiles.size()))); // share the cores between the workers
+#endif
+    PROFILE_RESET(); // the stats inherited from the coordinator are reported by the coordinator
+    const Tile &tile = tiles[itile];
+    TGAImage image(tile.w, tile.h, TGAImage::RGB, background);
+    render_tile(itile, image);
+    bool ok = write_all(fd, image.buffer(), tile.w*tile.h*TGAImage::RGB);
+#ifdef INSTRUMENT
+    const profile::Frame frame = profile::take();
+    ok = ok && write_all(fd, reinterpret_cast<const std::uint8_t *>(&frame), sizeof(frame));
+#endif
+#if defined(INSTRUMENT) && defined(HEATMAP)
+    for (int k=0; k<profile::NHEATMAPS; k++)
+        ok = ok && write_all(fd, reinterpret_cast<const std::uint8_t *>(profile::heatmap(profile::Heatmap(k))), tile.w*tile.h*sizeof(std::int64_t));
+#endif
+    _exit(ok ? 0 : 1);
+}
+#endif
+
+bool render_tiled(TGAImage &framebuffer, const int width, const int height, const TGAColor background,
+                  const std::vector<Tile> &tiles, const std::function<void(const int, TGAImage &)> &render_tile) {
+    if (tiles.size()==1 && tiles[0].w==width && tiles[0].h==height) {
+        framebuffer = TGAImage(width, height, TGAImage::RGB, background);
+        render_tile(0, framebuffer); // the whole screen, no need for a copy
+        return true;
+    }
+    framebuffer = TGAImage(width, height, TGAImage::RGB); // every pixel belongs to a tile, no need for the background
+#ifdef TILES_FORK
+    {
+        std::cout.flush(); // do not let the workers inherit pending output
+        std::vector<pid_t> pids;
+        std::vector<int> fds;
+        bool ok = true;
+        for (int i=0; ok && i<static_cast<int>(tiles.size()); i++) {
+            int fd[2];
+            if (pipe(fd)) {
+                std::cerr << "can't create a pipe for the tile " << i << "\n";
+                ok = false;
+                break;
+            }
+            pid_t pid = fork();
+            if (!pid) {
+                close(fd[0]);
+                for (int f : fds) close(f); // the read ends of the previous workers, only the coordinator may hold them
+                worker(tiles, i, background, render_tile, fd[1]); // does not return
+            }
+            close(fd[1]);
+            if (pid<0) {
+                std::cerr << "can't fork a worker for the tile " << i << "\n";
+                close(fd[0]);
+                ok = false;
+                break;
+            }
+            pids.push_back(pid);
+            fds.push_back(fd[0]);
+        }
+#if defined(INSTRUMENT) && defined(HEATMAP)
+        profile::init_heatmap(width, height); // the workers send their tile of the heatmaps as well
+#endif
+        for (int i=0; i<static_cast<int>(pids.size()); i++) { // the workers run concurrently, collect the tiles in order
+            const Tile &tile = tiles[i];
+            bool received = ok;
+            for (int y=0; received && y<tile.h; y++) // read the rows straight into the framebuffer
+                received = read_all(fds[i], framebuffer.buffer() + (tile.x+(tile.y+y)*width)*TGAImage::RGB, tile.w*TGAImage::RGB);
+#ifdef INSTRUMENT
+            profile::Frame frame;
+            received = received && read_all(fds[i], reinterpret_cast<std::uint8_t *>(&frame), sizeof(frame));
+            if (received) profile::merge_tile(i, frame);
+#endif
+#if defined(INSTRUMENT) && defined(HEATMAP)
+            for (int k=0; k<profile::NHEATMAPS; k++)
+                for (int y=0; received && y<tile.h; y++)
+                    received = read_all(fds[i], reinterpret_cast<std::uint8_t *>(profile::heatmap(profile::Heatmap(k)) + tile.x+(tile.y+y)*width), tile.w*sizeof(std::int64_t));
+#endif
+            if (ok && !received) {
+                std::cerr << "can't read the tile " << i << " from its worker\n";
+                ok = false;
+            }
+            close(fds[i]);
+            int status = 0;
+            if (waitpid(pids[i], &status, 0)<0 || !WIFEXITED(status) || WEXITSTATUS(status)) {
+                if (ok) std::cerr << "the worker of the tile " << i << " failed\n";
+                ok = false;
+            }
+        }
+        return ok;
+    }
+#endif
+#if defined(INSTRUMENT) && defined(HEATMAP)
+    std::vector<std::int64_t> heatmaps[profile::NHEATMAPS]; // render_tile() sets the heatmaps up for the tile, stitch them aside
+    for (auto &map : heatmaps) map.resize(width*height);
+#endif
+    for (int i=0; i<static_cast<int>(tiles.size()); i++) { // no worker processes, render the tiles one by one
+#ifdef INSTRUMENT
+        const profile::Frame coordinator = profile::take(); // set aside the stats of the coordinator to isolate the tile
+#endif
+        TGAImage image(tiles[i].w, tiles[i].h, TGAImage::RGB, background);
+        render_tile(i, image);
+        blit(framebuffer, tiles[i], image);
+#ifdef INSTRUMENT
+        profile::merge_tile(i, profile::take());
+        profile::merge(coordinator);
+#endif
+#if defined(INSTRUMENT) && defined(HEATMAP)
+        for (int k=0; k<profile::NHEATMAPS; k++)
+            for (int y=0; y<tiles[i].h; y++)
+                std::memcpy(heatmaps[k].data() + tiles[i].x+(tiles[i].y+y)*width, profile::heatmap(profile::Heatmap(k)) + y*tiles[i].w, tiles[i].w*sizeof(std::int64_t));
+#endif
+    }
+#if defined(INSTRUMENT) && defined(HEATMAP)
+    profile::init_heatmap(width, height);
+    for (int k=0; k<profile::NHEATMAPS; k++)
+        std::memcpy(profile::heatmap(profile::Heatmap(k)), heatmaps[k].data(), width*height*sizeof(std::int64_t));
+#endif
+    return true;
+}
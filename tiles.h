@@ -0,0 +1,21 @@
+#pragma once
+#include <functional>
+#include <vector>
+#include "tgaimage.h"
+
+// Sort-first parallel rendering: the screen is split into tiles, each one is rendered by an independent
+// worker process with its own framebuffer and depth buffer, the coordinator stitches the tiles together.
+
+struct Tile {
+    int x, y; // bottom left corner in the final image
+    int w, h; // size in pixels
+};
+
+std::vector<Tile> split_screen(const int width, const int height, const int ntiles); // a grid of ntiles nearly square tiles
+
+// Fills framebuffer with a width x height RGB image made of the tiles.
+// render_tile(i, image) must render the tile i into image, the latter is tiles[i].w x tiles[i].h and filled with the background.
+// Each tile is rendered in its own forked process, a single tile is rendered in the calling process.
+// N.B. call it before any OpenMP parallel region: the OpenMP runtime of a forked worker hangs if its parent had started threads.
+bool render_tiled(TGAImage &framebuffer, const int width, const int height, const TGAColor background,
+                  const std::vector<Tile> &tiles, const std::function<void(const int, TGAImage &)> &render_tile);